@@ -0,0 +1,67 @@
+/*
+ * EmkyLog
+ * Copyright (c) from 2025 - to 18446744073709551615, author: Natik Agaev
+ * All rights reserved.
+ *
+ * If you find bugs - please, contact IMMEDIATELY!
+ */
+
+#include "EmkyLogFwd.h"
+#include "EmkyLog.h"
+
+namespace {
+    using native_error_code = decltype(emkylog::init());
+
+    static_assert(static_cast<int>(emkylog_fwd::error_code::WRITE_FAILED) == static_cast<int>(native_error_code::WRITE_FAILED), "emkylog_fwd::error_code is out of sync with emkylog");
+    static_assert(static_cast<std::uint32_t>(emkylog_fwd::mode::json) == static_cast<std::uint32_t>(emkylog::mode::json), "emkylog_fwd::mode is out of sync with emkylog");
+
+    emkylog_fwd::error_code convert(const native_error_code code) noexcept {
+        return static_cast<emkylog_fwd::error_code>(code);
+    }
+
+    template <typename T> void append_to_chars(std::string & string, const T v) {
+        char tmp[128];
+        auto [ptr, ec] = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        if (ec == std::errc{}) {
+            string.append(tmp, ptr);
+        } else {
+            string += "<to_chars_error>";
+        }
+    }
+}
+
+
+emkylog_fwd::error_code emkylog_fwd::Init() {return emkylog_fwd::init();}
+emkylog_fwd::error_code emkylog_fwd::Close() {return emkylog_fwd::close();}
+
+
+emkylog_fwd::error_code emkylog_fwd::init() {
+    return convert(emkylog::init());
+}
+
+
+emkylog_fwd::error_code emkylog_fwd::close() {
+    return convert(emkylog::close());
+}
+
+
+emkylog_fwd::error_code emkylog_fwd::log_args(const bool error, const std::initializer_list<arg> args) {
+    std::string string;
+    emkylog::mode mode = emkylog::mode::none;
+
+    for (const arg & a : args) {
+        switch (a.kind_) {
+            case arg::kind::text: string.append(a.text.data, a.text.size); break;
+            case arg::kind::character: string.push_back(a.character); break;
+            case arg::kind::boolean: string += (a.boolean ? "true" : "false"); break;
+            case arg::kind::signed_integer: append_to_chars(string, a.signed_integer); break;
+            case arg::kind::unsigned_integer: append_to_chars(string, a.unsigned_integer); break;
+            case arg::kind::float_: append_to_chars(string, a.float_); break;
+            case arg::kind::double_: append_to_chars(string, a.double_); break;
+            case arg::kind::long_double: append_to_chars(string, a.long_double); break;
+            case arg::kind::control: mode = static_cast<emkylog::mode>(a.control); break;
+        }
+    }
+
+    return convert(error ? emkylog::log_error(string, mode) : emkylog::log(string, mode));
+}
@@ -0,0 +1,17 @@
+/*
+ * EmkyLog
+ * Copyright (c) from 2025 - to 18446744073709551615, author: Natik Agaev
+ * All rights reserved.
+ *
+ * If you find bugs - please, contact IMMEDIATELY!
+ */
+
+/* C++20 module interface of EmkyLog: `import emkylog;` instead of including EmkyLog.h.
+   The standard headers are parsed once when the module is built instead of once per importing translation unit. */
+
+module;
+#include "EmkyLog.h"
+
+export module emkylog;
+
+export using ::emkylog;
@@ -21,12 +21,63 @@
 #include <optional>
 #include <chrono>
 #include <charconv>
+#include <limits>
 #include <string_view>
 #include <mutex>
+#include <atomic>
 #include <filesystem>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <bitset>
+#include <span>
+#include <memory>
+#include <condition_variable>
+#include <stop_token>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <bit>
+#include <algorithm>
+
+#if defined(_WIN32)
+/* The three kernel32 functions of multi-process mode are declared here instead of including <windows.h>, which would leak
+   NO_ERROR, min, max and the rest of its macros into every includer. The signatures are the ones of the Windows SDK and MinGW,
+   so <windows.h> can still be included before or after this header. */
+struct _SECURITY_ATTRIBUTES;
+struct _OVERLAPPED;
+
+extern "C" {
+    __declspec(dllimport) void * __stdcall CreateFileW(const wchar_t *, unsigned long, unsigned long, _SECURITY_ATTRIBUTES *, unsigned long, unsigned long, void *);
+    __declspec(dllimport) int __stdcall WriteFile(void *, const void *, unsigned long, unsigned long *, _OVERLAPPED *);
+    __declspec(dllimport) int __stdcall CloseHandle(void *);
+}
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+
+// <windows.h> included before this header defines these as macros; they are restored at the end.
+#pragma push_macro("NO_ERROR")
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef NO_ERROR
+#undef min
+#undef max
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define EMKYLOG_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EMKYLOG_SSE2
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define EMKYLOG_SSSE3
+#endif
+#endif
 
 /* TODO:
     -- Completely rewrite the appending operator as it seems the compiler mixes the '<' operator.
@@ -51,17 +102,29 @@ class emkylog {
         INVALID_FILENAME,
         FAILED_DIRECTORY_CREATION,
         CANNOT_OPEN_ERROR_LOG_FILE,
-        FAILED_FILE_CREATION
+        FAILED_FILE_CREATION,
+        INVALID_UTF8,
+        WRITE_FAILED
     };
 
+#if defined(_WIN32)
+    using native_handle = void *;
+#else
+    using native_handle = int;
+#endif
+
     static std::string log_path;
     static std::string error_log_path;
     static std::string log_filename;
     static std::string error_log_filename;
     static std::ofstream log_stream;
     static std::ofstream error_log_stream;
-    static bool inited;
+    static native_handle log_handle;
+    static native_handle error_log_handle;
+    static std::atomic<bool> inited;
     static std::recursive_mutex mtx;
+    static std::mutex log_mtx;
+    static std::mutex error_log_mtx;
 
 public:
     struct settings_s {
@@ -69,6 +132,10 @@ public:
         bool auto_threadid = false;
         bool auto_date = false;
         bool auto_time = false;
+        bool auto_sanitize = false;
+        bool auto_json_escape = false;
+        bool reject_invalid_utf8 = false;
+        bool multi_process = false;
     };
 
 
@@ -78,7 +145,15 @@ public:
         nonewline = 1<<1,
         threadid = 1<<2,
         date = 1<<4,
-        time = 1<<5
+        time = 1<<5,
+        sanitize = 1<<6,
+        json = 1<<7
+    };
+
+    enum class encoding {
+        hex,
+        base64,
+        raw
     };
 
     friend constexpr mode operator | (const mode m1, const mode m2) noexcept {
@@ -111,8 +186,16 @@ public:
     static void SetAutoDateSetting(bool &&) noexcept;
     static void set_auto_time_setting(bool &&) noexcept;
     static void SetAutoTimeSetting(bool &&) noexcept;
-    static settings_s & get_settings() noexcept;
-    static settings_s & GetSettings() noexcept;
+    static void set_auto_sanitize_setting(bool &&) noexcept;
+    static void SetAutoSanitizeSetting(bool &&) noexcept;
+    static void set_auto_json_escape_setting(bool &&) noexcept;
+    static void SetAutoJSONEscapeSetting(bool &&) noexcept;
+    static void set_reject_invalid_utf8_setting(bool &&) noexcept;
+    static void SetRejectInvalidUTF8Setting(bool &&) noexcept;
+    static void set_multi_process_setting(bool &&) noexcept;
+    static void SetMultiProcessSetting(bool &&) noexcept;
+    static settings_s get_settings() noexcept;
+    static settings_s GetSettings() noexcept;
     static std::string_view get_log_path() noexcept;
     static std::string_view GetLogPath() noexcept;
     static std::string_view get_error_log_path() noexcept;
@@ -129,6 +212,14 @@ public:
     static bool GetAutoDateSetting() noexcept;
     static bool get_auto_time_setting() noexcept;
     static bool GetAutoTimeSetting() noexcept;
+    static bool get_auto_sanitize_setting() noexcept;
+    static bool GetAutoSanitizeSetting() noexcept;
+    static bool get_auto_json_escape_setting() noexcept;
+    static bool GetAutoJSONEscapeSetting() noexcept;
+    static bool get_reject_invalid_utf8_setting() noexcept;
+    static bool GetRejectInvalidUTF8Setting() noexcept;
+    static bool get_multi_process_setting() noexcept;
+    static bool GetMultiProcessSetting() noexcept;
     static error_code log(std::string_view, mode=mode::none);
     template<typename...Args> static error_code log(Args&&...);
     static error_code Log(std::string_view, mode=mode::none);
@@ -137,6 +228,10 @@ public:
     template<typename...Args> static error_code log_error(Args&&...);
     static error_code LogError(std::string_view, mode=mode::none);
     template<typename...Args> static error_code LogError(Args&&...);
+    static error_code log_bytes(std::span<const std::byte>, encoding=encoding::hex, mode=mode::none);
+    static error_code LogBytes(std::span<const std::byte>, encoding=encoding::hex, mode=mode::none);
+    static error_code log_error_bytes(std::span<const std::byte>, encoding=encoding::hex, mode=mode::none);
+    static error_code LogErrorBytes(std::span<const std::byte>, encoding=encoding::hex, mode=mode::none);
     static error_code open();
     static error_code Open();
     static error_code open_logger();
@@ -152,6 +247,8 @@ public:
     static bool initiated() noexcept;
     static bool Initiated() noexcept;
 
+    class batch;
+
 private:
     enum class level {
         info, error
@@ -164,6 +261,8 @@ private:
         bool suppress_final_newline = false;
         mode mode_;
 
+        friend class emkylog::batch;
+
         static emkylog::error_code flush(const level lvl, const std::string_view str, const emkylog::mode & mode) {
             return (lvl == level::info) ? emkylog::log(str, mode) : emkylog::log_error(str, mode);
         }
@@ -212,7 +311,6 @@ private:
         }
 
         [[nodiscard]] emkylog::error_code flush_now() {
-            std::lock_guard lock (emkylog::mtx);
             this->auto_flush = false;
             return flush(this->lvl, this->string, this->mode_);
         }
@@ -232,7 +330,6 @@ private:
     struct stream {
         level lvl;
         template <typename T> line operator << (T && v) const {
-            std::lock_guard lock (emkylog::mtx);
             line l(lvl);
             l << std::forward<T>(v);
             return l;
@@ -245,10 +342,99 @@ private:
     template<typename... Ts> using control_type_t = typename control_type<Ts...>::type;
     template<typename Tuple, size_t... Is> static void stream_prefix(line&, Tuple&&, std::index_sequence<Is...>);
 
+    static bool is_unsafe(unsigned char, bool) noexcept;
+    static std::size_t find_unsafe(std::string_view, bool) noexcept;
+    static std::pair<std::size_t, bool> scan_utf8(std::string_view, std::size_t, std::size_t, bool) noexcept;
+    static std::size_t utf8_boundary(std::string_view, std::size_t) noexcept;
+#if defined(EMKYLOG_AVX2)
+    static __m256i utf8_errors(__m256i, __m256i) noexcept;
+#elif defined(EMKYLOG_SSSE3)
+    static __m128i utf8_errors(__m128i, __m128i) noexcept;
+#endif
+    static std::pair<std::size_t, bool> utf8_sequence_length(std::string_view) noexcept;
+    static void escape(unsigned char, std::string &, bool);
+    static bool sanitize(std::string_view, std::string &, bool, bool);
+    static bool sanitize_payload(std::string_view &, std::string &, std::underlying_type_t<mode>, const settings_s &);
+    struct prefix_cache {
+        std::string date;
+        std::string time;
+    };
+
+    static error_code ensure_init();
+    static void append_prefix(std::string &, std::underlying_type_t<mode>, const settings_s &, prefix_cache &);
+    static void append_newline(std::string &, std::underlying_type_t<mode>, const settings_s &);
+    static error_code make_record(std::string &, std::string_view, mode, prefix_cache &);
+    static error_code write_record(level, std::string_view);
+    static error_code write_record(level, std::span<const std::string_view>);
+    static error_code log_bytes(level, std::span<const std::byte>, encoding, mode);
+    static void encode_hex(std::span<const std::byte>, char *) noexcept;
+    static void encode_base64(std::span<const std::byte>, char *) noexcept;
+    template <typename F> static void update_settings(F &&) noexcept;
+
+#if defined(_WIN32)
+    static constexpr native_handle invalid_handle = nullptr;
+    static constexpr unsigned long file_append_data = 0x0004;
+    static constexpr unsigned long file_share_read_write_delete = 0x0001 | 0x0002 | 0x0004;
+    static constexpr unsigned long open_always = 4;
+    static constexpr unsigned long file_attribute_normal = 0x0080;
+#else
+    static constexpr native_handle invalid_handle = -1;
+#endif
+    static native_handle open_append(const std::filesystem::path &) noexcept;
+    static bool write_append(native_handle, std::string_view) noexcept;
+    static bool write_append(native_handle, std::span<const std::string_view>) noexcept;
+    static void close_append(native_handle &) noexcept;
+
 public:
     static constexpr stream loginfo {level::info};
     static constexpr stream logerror {level::error};
 
+    class batch {
+        struct entry {
+            level lvl;
+            std::size_t size;
+            emkylog::mode mode_;
+        };
+
+        std::string body;
+        std::vector<entry> entries;
+
+        template <typename...Args> batch & add(level, Args&&...);
+
+    public:
+        batch() = default;
+        batch(const batch &) = delete;
+        batch & operator = (const batch &) = delete;
+        batch(batch && other) noexcept : body(std::move(other.body)), entries(std::move(other.entries)) {
+            other.entries.clear();
+        }
+
+        batch & operator = (batch && other) noexcept {
+            if (this != &other) {
+                (void)this->commit();
+                this->body = std::move(other.body);
+                this->entries = std::move(other.entries);
+                other.entries.clear();
+            }
+            return *this;
+        }
+
+        ~batch() noexcept {
+            (void)this->commit();
+        }
+
+        template <typename...Args> batch & log(Args&&...args) {return this->add(level::info, std::forward<Args>(args)...);}
+        template <typename...Args> batch & Log(Args&&...args) {return this->add(level::info, std::forward<Args>(args)...);}
+        template <typename...Args> batch & log_error(Args&&...args) {return this->add(level::error, std::forward<Args>(args)...);}
+        template <typename...Args> batch & LogError(Args&&...args) {return this->add(level::error, std::forward<Args>(args)...);}
+        emkylog::error_code commit() noexcept;
+        emkylog::error_code Commit() noexcept {return this->commit();}
+        void clear() noexcept {this->body.clear(); this->entries.clear();}
+        void Clear() noexcept {this->clear();}
+        [[nodiscard]] std::size_t size() const noexcept {return this->entries.size();}
+        [[nodiscard]] std::size_t Size() const noexcept {return this->size();}
+    };
+
 private:
     enum phase {enter, exit, exception};
 
@@ -284,11 +470,118 @@ private:
     };
 
     static void log_event(const event & e);
-    static settings_s settings;
+    static std::atomic<settings_s> settings;
 
 public:
     template <typename F> static constexpr auto observe(std::string_view, F&&, std::string_view="none");
 
+private:
+    static constexpr std::size_t metric_shards = 16;
+
+    struct metric_entry {
+        const void * self;
+        void (*report)(const void *, batch &, double);
+    };
+
+    static std::size_t metric_shard() noexcept;
+    template <typename M> static void register_metric(const M *);
+    static void unregister_metric(const void *) noexcept;
+
+    static std::mutex metrics_mtx;
+    static std::vector<metric_entry> metrics;
+    static std::chrono::steady_clock::time_point metrics_flushed;
+    static std::mutex metrics_thread_mtx;
+    static std::jthread metrics_thread;
+
+public:
+    class counter {
+        struct alignas(64) shard {
+            std::atomic<std::uint64_t> value {0};
+        };
+
+        std::string name_;
+        mutable shard shards[metric_shards];
+
+        friend class emkylog;
+        void report(batch &, double) const;
+
+    public:
+        explicit counter(std::string_view);
+        counter(const counter &) = delete;
+        counter & operator = (const counter &) = delete;
+        ~counter();
+
+        void add(const std::uint64_t n = 1) noexcept {this->shards[emkylog::metric_shard()].value.fetch_add(n, std::memory_order_relaxed);}
+        void Add(const std::uint64_t n = 1) noexcept {this->add(n);}
+        counter & operator ++ () noexcept {this->add(); return *this;}
+        counter & operator += (const std::uint64_t n) noexcept {this->add(n); return *this;}
+    };
+
+    class gauge {
+        struct alignas(64) shard {
+            std::atomic<std::int64_t> min {std::numeric_limits<std::int64_t>::max()};
+            std::atomic<std::int64_t> max {std::numeric_limits<std::int64_t>::min()};
+            std::atomic<std::uint64_t> samples {0};
+        };
+
+        std::string name_;
+        alignas(64) std::atomic<std::int64_t> value_ {0};
+        mutable shard shards[metric_shards];
+
+        friend class emkylog;
+        void observe(std::int64_t) noexcept;
+        void report(batch &, double) const;
+
+    public:
+        explicit gauge(std::string_view);
+        gauge(const gauge &) = delete;
+        gauge & operator = (const gauge &) = delete;
+        ~gauge();
+
+        void set(const std::int64_t v) noexcept {this->value_.store(v, std::memory_order_relaxed); this->observe(v);}
+        void Set(const std::int64_t v) noexcept {this->set(v);}
+        void add(const std::int64_t d) noexcept {this->observe(this->value_.fetch_add(d, std::memory_order_relaxed) + d);}
+        void Add(const std::int64_t d) noexcept {this->add(d);}
+    };
+
+    class histogram {
+        struct alignas(64) shard {
+            std::atomic<double> sum {0};
+        };
+
+        struct alignas(64) bucket_line {
+            static constexpr std::size_t size = 64 / sizeof(std::atomic<std::uint64_t>);
+            std::atomic<std::uint64_t> slots[size] {};
+        };
+
+        std::string name_;
+        std::vector<double> bounds;
+        std::size_t lines_per_row;
+        std::unique_ptr<bucket_line[]> lines;
+        mutable shard sums[metric_shards];
+
+        friend class emkylog;
+        std::atomic<std::uint64_t> & bucket(const std::size_t shard, const std::size_t i) const noexcept {
+            return this->lines[shard * this->lines_per_row + i / bucket_line::size].slots[i % bucket_line::size];
+        }
+        void report(batch &, double) const;
+
+    public:
+        histogram(std::string_view, std::initializer_list<double>);
+        histogram(const histogram &) = delete;
+        histogram & operator = (const histogram &) = delete;
+        ~histogram();
+
+        void record(double) noexcept;
+        void Record(const double v) noexcept {this->record(v);}
+    };
+
+    static void start_metrics(std::chrono::milliseconds=std::chrono::seconds(10));
+    static void StartMetrics(std::chrono::milliseconds=std::chrono::seconds(10));
+    static void stop_metrics();
+    static void StopMetrics();
+    static error_code flush_metrics();
+    static error_code FlushMetrics();
 };
 
 inline std::string emkylog::log_path = (std::filesystem::current_path() / "emkylog").string();
@@ -297,9 +590,19 @@ inline std::string emkylog::log_filename = "emkylog.txt";
 inline std::string emkylog::error_log_filename = "emkyerrlog.txt";
 inline std::ofstream emkylog::log_stream = {};
 inline std::ofstream emkylog::error_log_stream = {};
-inline bool emkylog::inited = false;
+inline emkylog::native_handle emkylog::log_handle = emkylog::invalid_handle;
+inline emkylog::native_handle emkylog::error_log_handle = emkylog::invalid_handle;
+inline std::atomic<bool> emkylog::inited = false;
 inline std::recursive_mutex emkylog::mtx;
-inline emkylog::settings_s emkylog::settings;
+inline std::mutex emkylog::log_mtx;
+inline std::mutex emkylog::error_log_mtx;
+inline std::atomic<emkylog::settings_s> emkylog::settings {emkylog::settings_s{}};
+static_assert(std::atomic<emkylog::settings_s>::is_always_lock_free, "emkylog::settings_s must stay small enough for a lock-free std::atomic, the logging hot path relies on it");
+inline std::mutex emkylog::metrics_mtx;
+inline std::vector<emkylog::metric_entry> emkylog::metrics;
+inline std::chrono::steady_clock::time_point emkylog::metrics_flushed = std::chrono::steady_clock::now();
+inline std::mutex emkylog::metrics_thread_mtx;
+inline std::jthread emkylog::metrics_thread;
 
 inline emkylog::error_code emkylog::Init() {return emkylog::init();}
 inline emkylog::error_code emkylog::SetSettings(const emkylog::settings_s & control) noexcept {return emkylog::set_settings(control);}
@@ -311,7 +614,11 @@ inline void emkylog::SetAutoNewLineSetting(bool && boolean) noexcept {return emk
 inline void emkylog::SetAutoDateSetting(bool && boolean) noexcept {return emkylog::set_auto_date_setting(static_cast<bool&&>(boolean));}
 inline void emkylog::SetAutoThreadIDSetting(bool && boolean) noexcept {return emkylog::set_auto_thread_id_setting(static_cast<bool&&>(boolean));}
 inline void emkylog::SetAutoTimeSetting(bool && boolean) noexcept {return emkylog::set_auto_time_setting(static_cast<bool&&>(boolean));}
-inline emkylog::settings_s & emkylog::GetSettings() noexcept {return emkylog::get_settings();}
+inline void emkylog::SetAutoSanitizeSetting(bool && boolean) noexcept {return emkylog::set_auto_sanitize_setting(static_cast<bool&&>(boolean));}
+inline void emkylog::SetAutoJSONEscapeSetting(bool && boolean) noexcept {return emkylog::set_auto_json_escape_setting(static_cast<bool&&>(boolean));}
+inline void emkylog::SetRejectInvalidUTF8Setting(bool && boolean) noexcept {return emkylog::set_reject_invalid_utf8_setting(static_cast<bool&&>(boolean));}
+inline void emkylog::SetMultiProcessSetting(bool && boolean) noexcept {return emkylog::set_multi_process_setting(static_cast<bool&&>(boolean));}
+inline emkylog::settings_s emkylog::GetSettings() noexcept {return emkylog::get_settings();}
 inline std::string_view emkylog::GetLogPath() noexcept {return emkylog::get_log_path();}
 inline std::string_view emkylog::GetErrorLogPath() noexcept {return emkylog::get_error_log_path();}
 inline std::string_view emkylog::GetLogFilename() noexcept {return emkylog::get_log_filename();}
@@ -320,12 +627,21 @@ inline bool emkylog::GetAutoNewLineSetting() noexcept {return emkylog::get_auto_
 inline bool emkylog::GetAutoDateSetting() noexcept {return emkylog::get_auto_date_setting();}
 inline bool emkylog::GetAutoThreadIDSetting() noexcept {return emkylog::get_auto_thread_id_setting();}
 inline bool emkylog::GetAutoTimeSetting() noexcept {return emkylog::get_auto_time_setting();}
+inline bool emkylog::GetAutoSanitizeSetting() noexcept {return emkylog::get_auto_sanitize_setting();}
+inline bool emkylog::GetAutoJSONEscapeSetting() noexcept {return emkylog::get_auto_json_escape_setting();}
+inline bool emkylog::GetRejectInvalidUTF8Setting() noexcept {return emkylog::get_reject_invalid_utf8_setting();}
+inline bool emkylog::GetMultiProcessSetting() noexcept {return emkylog::get_multi_process_setting();}
 inline emkylog::error_code emkylog::Log(const std::string_view log, const emkylog::mode mode) {return emkylog::log(log, mode);}
 inline emkylog::error_code emkylog::LogError(const std::string_view log, const emkylog::mode mode) {return emkylog::log_error(log, mode);}
+inline emkylog::error_code emkylog::LogBytes(const std::span<const std::byte> bytes, const emkylog::encoding enc, const emkylog::mode mode) {return emkylog::log_bytes(bytes, enc, mode);}
+inline emkylog::error_code emkylog::LogErrorBytes(const std::span<const std::byte> bytes, const emkylog::encoding enc, const emkylog::mode mode) {return emkylog::log_error_bytes(bytes, enc, mode);}
 inline emkylog::error_code emkylog::OpenLogger() {return emkylog::open_logger();}
 inline emkylog::error_code emkylog::Close() {return emkylog::close();}
 inline emkylog::error_code emkylog::CloseLogger() {return emkylog::close_logger();}
 inline bool emkylog::Initiated() noexcept {return emkylog::initiated();}
+inline void emkylog::StartMetrics(const std::chrono::milliseconds interval) {emkylog::start_metrics(interval);}
+inline void emkylog::StopMetrics() {emkylog::stop_metrics();}
+inline emkylog::error_code emkylog::FlushMetrics() {return emkylog::flush_metrics();}
 template <typename... Args> emkylog::error_code emkylog::LogError(Args &&... args) {return emkylog::log_error(std::forward<Args>(args)...);}
 template <typename... Args> emkylog::error_code emkylog::Log(Args &&... args) {return emkylog::log(std::forward<Args>(args)...);}
 
@@ -336,22 +652,35 @@ inline emkylog::error_code emkylog::init() {
     if (emkylog::set_log_path(emkylog::log_path) != error_code::NO_ERROR || emkylog::set_error_log_path(emkylog::error_log_path) != error_code::NO_ERROR || emkylog::set_log_filename(emkylog::log_filename) != error_code::NO_ERROR || emkylog::set_error_log_filename(emkylog::error_log_filename) != error_code::NO_ERROR) {
         return emkylog::error_code::INIT_FAILED;
     }
-    emkylog::inited = true;
+    emkylog::inited.store(true, std::memory_order_release);
 
     return emkylog::error_code::NO_ERROR;
 }
 
 
-inline emkylog::error_code emkylog::set_settings(const settings_s settings) noexcept {
+// Once-only initialization for the logging paths: after the first success it is a single atomic load.
+inline emkylog::error_code emkylog::ensure_init() {
+    if (emkylog::inited.load(std::memory_order_acquire)) {
+        return error_code::NO_ERROR;
+    }
+
     std::lock_guard lock (emkylog::mtx);
-    emkylog::settings = settings;
+    if (emkylog::inited.load(std::memory_order_relaxed)) {
+        return error_code::NO_ERROR;
+    }
+    return emkylog::init();
+}
+
+
+inline emkylog::error_code emkylog::set_settings(const settings_s settings) noexcept {
+    emkylog::settings.store(settings, std::memory_order_release);
     return error_code::NO_ERROR;
 }
 
 
 inline emkylog::error_code emkylog::set_log_path(const std::string_view path) {
-    std::lock_guard lock (emkylog::mtx);
-    if (emkylog::log_stream.is_open()) {
+    std::lock_guard lock (emkylog::log_mtx);
+    if (emkylog::log_stream.is_open() || emkylog::log_handle != emkylog::invalid_handle) {
         return error_code::FILE_OPENED;
     }
 
@@ -369,8 +698,8 @@ inline emkylog::error_code emkylog::set_log_path(const std::string_view path) {
 
 
 inline emkylog::error_code emkylog::set_error_log_path(const std::string_view path) {
-    std::lock_guard lock (emkylog::mtx);
-    if (emkylog::error_log_stream.is_open()) {
+    std::lock_guard lock (emkylog::error_log_mtx);
+    if (emkylog::error_log_stream.is_open() || emkylog::error_log_handle != emkylog::invalid_handle) {
         return error_code::FILE_OPENED;
     }
 
@@ -388,8 +717,8 @@ inline emkylog::error_code emkylog::set_error_log_path(const std::string_view pa
 
 
 inline emkylog::error_code emkylog::set_log_filename(const std::string_view filename) noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    if (emkylog::log_stream.is_open()) {
+    std::lock_guard lock (emkylog::log_mtx);
+    if (emkylog::log_stream.is_open() || emkylog::log_handle != emkylog::invalid_handle) {
         return error_code::FILE_OPENED;
     }
 
@@ -407,8 +736,8 @@ inline emkylog::error_code emkylog::set_log_filename(const std::string_view file
 
 
 inline emkylog::error_code emkylog::set_error_log_filename(const std::string_view filename) noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    if (emkylog::error_log_stream.is_open()) {
+    std::lock_guard lock (emkylog::error_log_mtx);
+    if (emkylog::error_log_stream.is_open() || emkylog::error_log_handle != emkylog::invalid_handle) {
         return error_code::FILE_OPENED;
     }
 
@@ -426,129 +755,142 @@ inline emkylog::error_code emkylog::set_error_log_filename(const std::string_vie
 
 
 inline void emkylog::set_auto_new_line_setting(bool && boolean) noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    emkylog::settings.auto_newline = boolean;
+    emkylog::update_settings([&boolean](settings_s & s) {s.auto_newline = boolean;});
 }
 
 
 inline void emkylog::set_auto_thread_id_setting(bool && boolean) noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    emkylog::settings.auto_threadid = boolean;
+    emkylog::update_settings([&boolean](settings_s & s) {s.auto_threadid = boolean;});
 }
 
 
 inline void emkylog::set_auto_date_setting(bool && boolean) noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    emkylog::settings.auto_date = boolean;
+    emkylog::update_settings([&boolean](settings_s & s) {s.auto_date = boolean;});
 }
 
 
 inline void emkylog::set_auto_time_setting(bool && boolean) noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    emkylog::settings.auto_time = boolean;
+    emkylog::update_settings([&boolean](settings_s & s) {s.auto_time = boolean;});
 }
 
 
-inline emkylog::settings_s & emkylog::get_settings() noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    return emkylog::settings;
+inline void emkylog::set_auto_sanitize_setting(bool && boolean) noexcept {
+    emkylog::update_settings([&boolean](settings_s & s) {s.auto_sanitize = boolean;});
+}
+
+
+inline void emkylog::set_auto_json_escape_setting(bool && boolean) noexcept {
+    emkylog::update_settings([&boolean](settings_s & s) {s.auto_json_escape = boolean;});
+}
+
+
+inline void emkylog::set_reject_invalid_utf8_setting(bool && boolean) noexcept {
+    emkylog::update_settings([&boolean](settings_s & s) {s.reject_invalid_utf8 = boolean;});
+}
+
+
+inline void emkylog::set_multi_process_setting(bool && boolean) noexcept {
+    emkylog::update_settings([&boolean](settings_s & s) {s.multi_process = boolean;});
+}
+
+
+inline emkylog::settings_s emkylog::get_settings() noexcept {
+    return emkylog::settings.load(std::memory_order_acquire);
+}
+
+
+// Settings are published as a whole: readers load one consistent snapshot, writers swap in a modified copy.
+template <typename F> void emkylog::update_settings(F && f) noexcept {
+    settings_s expected = emkylog::settings.load(std::memory_order_relaxed);
+    settings_s desired;
+    do {
+        desired = expected;
+        f(desired);
+    } while (!emkylog::settings.compare_exchange_weak(expected, desired, std::memory_order_release, std::memory_order_relaxed));
 }
 
 
 inline std::string_view emkylog::get_log_path() noexcept {
-    std::lock_guard lock (emkylog::mtx);
+    std::lock_guard lock (emkylog::log_mtx);
     return emkylog::log_path;
 }
 
 
 inline std::string_view emkylog::get_error_log_path() noexcept {
-    std::lock_guard lock (emkylog::mtx);
+    std::lock_guard lock (emkylog::error_log_mtx);
     return emkylog::error_log_path;
 }
 
 
 inline std::string_view emkylog::get_log_filename() noexcept {
-    std::lock_guard lock (emkylog::mtx);
+    std::lock_guard lock (emkylog::log_mtx);
     return emkylog::log_filename;
 }
 
 
 inline std::string_view emkylog::get_error_log_filename() noexcept {
-    std::lock_guard lock (emkylog::mtx);
+    std::lock_guard lock (emkylog::error_log_mtx);
     return emkylog::error_log_filename;
 }
 
 
 inline bool emkylog::get_auto_new_line_setting() noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    return emkylog::settings.auto_newline;
+    return emkylog::settings.load(std::memory_order_acquire).auto_newline;
 }
 
 
 inline bool emkylog::get_auto_date_setting() noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    return emkylog::settings.auto_date;
+    return emkylog::settings.load(std::memory_order_acquire).auto_date;
 }
 
 
 inline bool emkylog::get_auto_thread_id_setting() noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    return emkylog::settings.auto_threadid;
+    return emkylog::settings.load(std::memory_order_acquire).auto_threadid;
 }
 
 
 inline bool emkylog::get_auto_time_setting() noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    return emkylog::settings.auto_time;
+    return emkylog::settings.load(std::memory_order_acquire).auto_time;
 }
 
 
-inline emkylog::error_code emkylog::log(const std::string_view slog, const emkylog::mode mode) {
-    std::lock_guard lock (emkylog::mtx);
-    if (!emkylog::initiated()) {
-        if (const emkylog::error_code res = emkylog::init(); res != error_code::NO_ERROR) {
-            return res;
-        }
-    }
+inline bool emkylog::get_auto_sanitize_setting() noexcept {
+    return emkylog::settings.load(std::memory_order_acquire).auto_sanitize;
+}
 
-    if (!emkylog::log_stream.is_open()) {
-        emkylog::log_stream.open(std::filesystem::path(emkylog::log_path) / emkylog::log_filename, std::ios::app);
 
-        if (!emkylog::log_stream.is_open()) {
-            return emkylog::error_code::FILE_CLOSED;
-        }
-    }
-    const std::underlying_type_t<emkylog::mode> bits = static_cast<std::underlying_type_t<emkylog::mode>>(mode);
+inline bool emkylog::get_auto_json_escape_setting() noexcept {
+    return emkylog::settings.load(std::memory_order_acquire).auto_json_escape;
+}
 
-    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::date) || emkylog::get_auto_date_setting()) {
-        emkylog::log_stream << std::format("{:%Y-%m-%d}", std::chrono::year_month_day{std::chrono::floor<std::chrono::days>(std::chrono::system_clock::now())}) << " ";
-    }
 
-    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::time) || emkylog::get_auto_time_setting()) {
-        emkylog::log_stream << std::format("{:%H:%M:%S}", std::chrono::zoned_time{std::chrono::current_zone(), std::chrono::system_clock::now()}) << " ";
-    }
+inline bool emkylog::get_reject_invalid_utf8_setting() noexcept {
+    return emkylog::settings.load(std::memory_order_acquire).reject_invalid_utf8;
+}
 
-    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::threadid) || emkylog::get_auto_thread_id_setting()) {
-        emkylog::log_stream << "TID: " << std::this_thread::get_id() << " ";
-    }
 
-    emkylog::log_stream << slog;
+inline bool emkylog::get_multi_process_setting() noexcept {
+    return emkylog::settings.load(std::memory_order_acquire).multi_process;
+}
 
-    bool is_newline = emkylog::get_auto_new_line_setting();
-    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::nonewline)) {
-        is_newline = false;
+
+inline emkylog::error_code emkylog::log(const std::string_view slog, const emkylog::mode mode) {
+    if (const emkylog::error_code res = emkylog::ensure_init(); res != error_code::NO_ERROR) {
+        return res;
     }
 
-    if ((bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::newline)) || is_newline) {
-        emkylog::log_stream << '\n';
+    std::string record;
+    prefix_cache cache;
+    if (const emkylog::error_code res = emkylog::make_record(record, slog, mode, cache); res != error_code::NO_ERROR) {
+        return res;
     }
-    emkylog::log_stream.flush();
-    return error_code::NO_ERROR;
+
+    std::lock_guard lock (emkylog::log_mtx);
+    return emkylog::write_record(level::info, record);
 }
 
 
 template <typename... Args> emkylog::error_code emkylog::log(Args &&... args) {
-    std::lock_guard lock (emkylog::mtx);
     using last_t = std::remove_cvref_t<emkylog::control_type_t<Args...>>;
 
     if constexpr (std::is_same_v<last_t, emkylog::mode>) {
@@ -567,52 +909,118 @@ template <typename... Args> emkylog::error_code emkylog::log(Args &&... args) {
 
 
 inline emkylog::error_code emkylog::log_error(const std::string_view slog, const emkylog::mode mode) {
-    std::lock_guard lock (emkylog::mtx);
-    if (!emkylog::initiated()) {
-        if (const emkylog::error_code res = emkylog::init(); res != error_code::NO_ERROR) {
-            return res;
-        }
+    if (const emkylog::error_code res = emkylog::ensure_init(); res != error_code::NO_ERROR) {
+        return res;
     }
 
-    if (!emkylog::error_log_stream.is_open()) {
-        emkylog::error_log_stream.open(std::filesystem::path(emkylog::error_log_path) / emkylog::error_log_filename, std::ios::app);
-
-        if (!emkylog::error_log_stream.is_open()) {
-            return error_code::FILE_CLOSED;
-        }
+    std::string record;
+    prefix_cache cache;
+    if (const emkylog::error_code res = emkylog::make_record(record, slog, mode, cache); res != error_code::NO_ERROR) {
+        return res;
     }
 
-    const std::underlying_type_t<emkylog::mode> bits = static_cast<std::underlying_type_t<emkylog::mode>>(mode);
+    std::lock_guard lock (emkylog::error_log_mtx);
+    return emkylog::write_record(level::error, record);
+}
+
 
-    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::date) || emkylog::get_auto_date_setting()) {
-        emkylog::error_log_stream << std::format("{:%Y-%m-%d}", std::chrono::year_month_day{std::chrono::floor<std::chrono::days>(std::chrono::system_clock::now())}) << " ";
+// The date and time are formatted once per cache, so records built together share one timestamp.
+inline void emkylog::append_prefix(std::string & record, const std::underlying_type_t<mode> bits, const settings_s & snapshot, prefix_cache & cache) {
+    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::date) || snapshot.auto_date) {
+        if (cache.date.empty()) {
+            cache.date = std::format("{:%Y-%m-%d}", std::chrono::year_month_day{std::chrono::floor<std::chrono::days>(std::chrono::system_clock::now())});
+        }
+        record += cache.date;
+        record += ' ';
     }
 
-    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::time) || emkylog::get_auto_time_setting()) {
-        emkylog::error_log_stream << std::format("{:%H:%M:%S}", std::chrono::zoned_time{std::chrono::current_zone(), std::chrono::system_clock::now()}) << " ";
+    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::time) || snapshot.auto_time) {
+        if (cache.time.empty()) {
+            cache.time = std::format("{:%H:%M:%S}", std::chrono::zoned_time{std::chrono::current_zone(), std::chrono::system_clock::now()});
+        }
+        record += cache.time;
+        record += ' ';
     }
 
-    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::threadid) || emkylog::get_auto_thread_id_setting()) {
-        emkylog::error_log_stream << "TID: " << std::this_thread::get_id() << " ";
+    if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::threadid) || snapshot.auto_threadid) {
+        static thread_local const std::string tid = (std::ostringstream{} << std::this_thread::get_id()).str();
+        record += "TID: ";
+        record += tid;
+        record += ' ';
     }
+}
 
-    emkylog::error_log_stream << slog;
 
-    bool is_newline = emkylog::get_auto_new_line_setting();
+inline void emkylog::append_newline(std::string & record, const std::underlying_type_t<mode> bits, const settings_s & snapshot) {
+    bool is_newline = snapshot.auto_newline;
     if (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::nonewline)) {
         is_newline = false;
     }
 
     if ((bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::newline)) || is_newline) {
-        emkylog::error_log_stream << '\n';
+        record += '\n';
+    }
+}
+
+
+inline emkylog::error_code emkylog::make_record(std::string & record, const std::string_view slog, const emkylog::mode mode, prefix_cache & cache) {
+    const std::underlying_type_t<emkylog::mode> bits = static_cast<std::underlying_type_t<emkylog::mode>>(mode);
+    const settings_s snapshot = emkylog::settings.load(std::memory_order_acquire);
+
+    std::string sanitized;
+    std::string_view payload = slog;
+    if (!emkylog::sanitize_payload(payload, sanitized, bits, snapshot)) {
+        return error_code::INVALID_UTF8;
     }
-    emkylog::error_log_stream.flush();
+
+    record.reserve(record.size() + payload.size() + 48);
+    emkylog::append_prefix(record, bits, snapshot, cache);
+    record += payload;
+    emkylog::append_newline(record, bits, snapshot);
     return error_code::NO_ERROR;
 }
 
 
+// The caller holds the mutex of the stream the record goes to.
+inline emkylog::error_code emkylog::write_record(const level lvl, const std::string_view record) {
+    return emkylog::write_record(lvl, std::span<const std::string_view>(&record, 1));
+}
+
+
+// Writes the parts of one record back to back without joining them first.
+inline emkylog::error_code emkylog::write_record(const level lvl, const std::span<const std::string_view> parts) {
+    std::ofstream & stream = (lvl == level::info) ? emkylog::log_stream : emkylog::error_log_stream;
+    native_handle & handle = (lvl == level::info) ? emkylog::log_handle : emkylog::error_log_handle;
+
+    if (emkylog::get_multi_process_setting()) {
+        if (handle == emkylog::invalid_handle) {
+            handle = emkylog::open_append((lvl == level::info) ? std::filesystem::path(emkylog::log_path) / emkylog::log_filename : std::filesystem::path(emkylog::error_log_path) / emkylog::error_log_filename);
+
+            if (handle == emkylog::invalid_handle) {
+                return error_code::FILE_CLOSED;
+            }
+        }
+
+        return emkylog::write_append(handle, parts) ? error_code::NO_ERROR : error_code::WRITE_FAILED;
+    }
+
+    if (!stream.is_open()) {
+        stream.open((lvl == level::info) ? std::filesystem::path(emkylog::log_path) / emkylog::log_filename : std::filesystem::path(emkylog::error_log_path) / emkylog::error_log_filename, std::ios::app);
+
+        if (!stream.is_open()) {
+            return error_code::FILE_CLOSED;
+        }
+    }
+
+    for (const std::string_view part : parts) {
+        stream.write(part.data(), static_cast<std::streamsize>(part.size()));
+    }
+    stream.flush();
+    return stream ? error_code::NO_ERROR : error_code::WRITE_FAILED;
+}
+
+
 template <typename... Args> emkylog::error_code emkylog::log_error(Args &&...args) {
-    std::lock_guard lock (emkylog::mtx);
     using last_t = std::remove_cvref_t<emkylog::control_type_t<Args...>>;
 
     if constexpr (std::is_same_v<last_t, emkylog::mode>) {
@@ -630,6 +1038,136 @@ template <typename... Args> emkylog::error_code emkylog::log_error(Args &&...arg
 }
 
 
+inline emkylog::error_code emkylog::log_bytes(const std::span<const std::byte> bytes, const encoding enc, const emkylog::mode mode) {
+    return emkylog::log_bytes(level::info, bytes, enc, mode);
+}
+
+
+inline emkylog::error_code emkylog::log_error_bytes(const std::span<const std::byte> bytes, const encoding enc, const emkylog::mode mode) {
+    return emkylog::log_bytes(level::error, bytes, enc, mode);
+}
+
+
+/* Hex and base64 are rendered straight into the record buffer. Raw payloads are not copied at all: the record is written as
+   "<prefixes>ATTACH <size> " followed by the bytes themselves and a newline, with one gathered write. */
+inline emkylog::error_code emkylog::log_bytes(const level lvl, const std::span<const std::byte> bytes, const encoding enc, const emkylog::mode mode) {
+    if (const emkylog::error_code res = emkylog::ensure_init(); res != error_code::NO_ERROR) {
+        return res;
+    }
+
+    const std::underlying_type_t<emkylog::mode> bits = static_cast<std::underlying_type_t<emkylog::mode>>(mode);
+    const settings_s snapshot = emkylog::settings.load(std::memory_order_acquire);
+    prefix_cache cache;
+    std::string record;
+
+    if (enc == encoding::raw) {
+        char size[24];
+        const auto [ptr, ec] = std::to_chars(size, size + sizeof(size), bytes.size());
+
+        emkylog::append_prefix(record, bits, snapshot, cache);
+        record += "ATTACH ";
+        record.append(size, ptr);
+        record += ' ';
+
+        const std::string_view parts[] = {record, std::string_view(reinterpret_cast<const char *>(bytes.data()), bytes.size()), "\n"};
+        std::lock_guard lock ((lvl == level::info) ? emkylog::log_mtx : emkylog::error_log_mtx);
+        return emkylog::write_record(lvl, parts);
+    }
+
+    const std::size_t size = (enc == encoding::hex) ? bytes.size() * 2 : (bytes.size() + 2) / 3 * 4;
+    record.reserve(size + 64);
+    emkylog::append_prefix(record, bits, snapshot, cache);
+
+    const std::size_t offset = record.size();
+    record.resize(offset + size);
+    if (enc == encoding::hex) {
+        emkylog::encode_hex(bytes, record.data() + offset);
+    } else {
+        emkylog::encode_base64(bytes, record.data() + offset);
+    }
+    emkylog::append_newline(record, bits, snapshot);
+
+    std::lock_guard lock ((lvl == level::info) ? emkylog::log_mtx : emkylog::error_log_mtx);
+    return emkylog::write_record(lvl, record);
+}
+
+
+// Lowercase hex, two characters per byte. The vector paths split every byte into nibbles, map 0-9 and a-f with one compare,
+// and interleave the high and low nibbles back into byte order.
+inline void emkylog::encode_hex(const std::span<const std::byte> bytes, char * out) noexcept {
+    static constexpr char digits[] = "0123456789abcdef";
+    const auto * const data = reinterpret_cast<const unsigned char *>(bytes.data());
+    const std::size_t size = bytes.size();
+    std::size_t i = 0;
+
+#if defined(EMKYLOG_AVX2)
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i letter = _mm256_set1_epi8('a' - '0' - 10);
+
+    for (; i + 32 <= size; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+        __m256i lo = _mm256_and_si256(v, nibble);
+        hi = _mm256_add_epi8(_mm256_add_epi8(hi, zero), _mm256_and_si256(_mm256_cmpgt_epi8(hi, nine), letter));
+        lo = _mm256_add_epi8(_mm256_add_epi8(lo, zero), _mm256_and_si256(_mm256_cmpgt_epi8(lo, nine), letter));
+
+        const __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+#elif defined(EMKYLOG_SSE2)
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letter = _mm_set1_epi8('a' - '0' - 10);
+
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+        __m128i lo = _mm_and_si128(v, nibble);
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+
+    for (; i < size; ++i) {
+        out[2 * i] = digits[data[i] >> 4];
+        out[2 * i + 1] = digits[data[i] & 0xF];
+    }
+}
+
+
+// Standard base64 (RFC 4648) with '=' padding.
+inline void emkylog::encode_base64(const std::span<const std::byte> bytes, char * out) noexcept {
+    static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const auto * const data = reinterpret_cast<const unsigned char *>(bytes.data());
+    const std::size_t size = bytes.size();
+    std::size_t i = 0;
+
+    for (; i + 3 <= size; i += 3) {
+        const std::uint32_t triple = (static_cast<std::uint32_t>(data[i]) << 16) | (static_cast<std::uint32_t>(data[i + 1]) << 8) | data[i + 2];
+        *out++ = alphabet[(triple >> 18) & 0x3F];
+        *out++ = alphabet[(triple >> 12) & 0x3F];
+        *out++ = alphabet[(triple >> 6) & 0x3F];
+        *out++ = alphabet[triple & 0x3F];
+    }
+
+    if (const std::size_t rest = size - i; rest != 0) {
+        const std::uint32_t triple = (static_cast<std::uint32_t>(data[i]) << 16) | (rest == 2 ? static_cast<std::uint32_t>(data[i + 1]) << 8 : 0);
+        *out++ = alphabet[(triple >> 18) & 0x3F];
+        *out++ = alphabet[(triple >> 12) & 0x3F];
+        *out++ = (rest == 2) ? alphabet[(triple >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+}
+
+
 inline emkylog::error_code emkylog::open() {
     if (const emkylog::error_code res = emkylog::open_error_logger(); res != error_code::NO_ERROR) {
         return res;
@@ -641,17 +1179,21 @@ inline emkylog::error_code emkylog::open() {
 
 
 inline emkylog::error_code emkylog::open_logger() {
-    std::lock_guard lock (emkylog::mtx);
-    if (!emkylog::initiated()) {
-        if (const emkylog::error_code res = emkylog::init(); res != error_code::NO_ERROR) {
-            return res;
-        }
+    if (const emkylog::error_code res = emkylog::ensure_init(); res != error_code::NO_ERROR) {
+        return res;
     }
 
-    if (emkylog::log_stream.is_open()) {
+    std::lock_guard lock (emkylog::log_mtx);
+
+    if (emkylog::log_stream.is_open() || emkylog::log_handle != emkylog::invalid_handle) {
         return error_code::FILE_OPENED;
     }
 
+    if (emkylog::get_multi_process_setting()) {
+        emkylog::log_handle = emkylog::open_append(std::filesystem::path(emkylog::log_path) / emkylog::log_filename);
+        return (emkylog::log_handle == emkylog::invalid_handle) ? error_code::FILE_CLOSED : error_code::NO_ERROR;
+    }
+
     emkylog::log_stream.open(std::filesystem::path(emkylog::log_path) / emkylog::log_filename, std::ios::app);
 
     if (!emkylog::log_stream.is_open()) {
@@ -662,17 +1204,21 @@ inline emkylog::error_code emkylog::open_logger() {
 
 
 inline emkylog::error_code emkylog::open_error_logger() {
-    std::lock_guard lock (emkylog::mtx);
-    if (!emkylog::initiated()) {
-        if (const emkylog::error_code res = emkylog::init(); res != error_code::NO_ERROR) {
-            return res;
-        }
+    if (const emkylog::error_code res = emkylog::ensure_init(); res != error_code::NO_ERROR) {
+        return res;
     }
 
-    if (emkylog::error_log_stream.is_open()) {
+    std::lock_guard lock (emkylog::error_log_mtx);
+
+    if (emkylog::error_log_stream.is_open() || emkylog::error_log_handle != emkylog::invalid_handle) {
         return error_code::FILE_OPENED;
     }
 
+    if (emkylog::get_multi_process_setting()) {
+        emkylog::error_log_handle = emkylog::open_append(std::filesystem::path(emkylog::error_log_path) / emkylog::error_log_filename);
+        return (emkylog::error_log_handle == emkylog::invalid_handle) ? error_code::FILE_CLOSED : error_code::NO_ERROR;
+    }
+
     emkylog::error_log_stream.open(std::filesystem::path(emkylog::error_log_path) / emkylog::error_log_filename, std::ios::app);
 
     if (!emkylog::error_log_stream.is_open()) {
@@ -692,30 +1238,148 @@ inline emkylog::error_code emkylog::close() {
 
 
 inline emkylog::error_code emkylog::close_logger() {
-    std::lock_guard lock (emkylog::mtx);
-    if (!emkylog::log_stream.is_open()) {
+    std::lock_guard lock (emkylog::log_mtx);
+    if (!emkylog::log_stream.is_open() && emkylog::log_handle == emkylog::invalid_handle) {
         return error_code::FILE_CLOSED;
     }
 
-    emkylog::log_stream.close();
+    if (emkylog::log_stream.is_open()) {
+        emkylog::log_stream.close();
+    }
+    emkylog::close_append(emkylog::log_handle);
     return error_code::NO_ERROR;
 }
 
 
 inline emkylog::error_code emkylog::close_error_logger() {
-    std::lock_guard lock (emkylog::mtx);
-    if (!emkylog::error_log_stream.is_open()) {
+    std::lock_guard lock (emkylog::error_log_mtx);
+    if (!emkylog::error_log_stream.is_open() && emkylog::error_log_handle == emkylog::invalid_handle) {
         return error_code::FILE_CLOSED;
     }
 
-    emkylog::error_log_stream.close();
+    if (emkylog::error_log_stream.is_open()) {
+        emkylog::error_log_stream.close();
+    }
+    emkylog::close_append(emkylog::error_log_handle);
     return error_code::NO_ERROR;
 }
 
 
 inline bool emkylog::initiated() noexcept {
-    std::lock_guard lock (emkylog::mtx);
-    return emkylog::inited;
+    return emkylog::inited.load(std::memory_order_acquire);
+}
+
+
+/* Multi-process mode writes every record with a single append-mode write, so concurrent writers never split each other's lines.
+   POSIX guarantees the seek-to-end and the write happen as one step for O_APPEND; Linux, BSD and macOS local file systems
+   additionally keep the whole write contiguous. Windows gives the same guarantee for FILE_APPEND_DATA handles on local volumes.
+   Network file systems (NFS, SMB) do not honour append atomically, and a single record larger than what the kernel accepts
+   in one write (about 2 GiB on Linux) is split. */
+inline emkylog::native_handle emkylog::open_append(const std::filesystem::path & path) noexcept {
+#if defined(_WIN32)
+    void * const handle = ::CreateFileW(path.c_str(), emkylog::file_append_data, emkylog::file_share_read_write_delete, nullptr,
+                                        emkylog::open_always, emkylog::file_attribute_normal, nullptr);
+    // INVALID_HANDLE_VALUE
+    return (handle == reinterpret_cast<void *>(static_cast<std::intptr_t>(-1))) ? emkylog::invalid_handle : handle;
+#else
+    int fd;
+    do {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    } while (fd == -1 && errno == EINTR);
+    return fd;
+#endif
+}
+
+
+inline bool emkylog::write_append(const native_handle handle, std::string_view record) noexcept {
+    while (!record.empty()) {
+#if defined(_WIN32)
+        unsigned long written = 0;
+        const unsigned long chunk = static_cast<unsigned long>(std::min<std::size_t>(record.size(), 0x7FFFFFFF));
+        if (!::WriteFile(handle, record.data(), chunk, &written, nullptr)) {
+            return false;
+        }
+#else
+        const ::ssize_t written = ::write(handle, record.data(), record.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+#endif
+        record.remove_prefix(static_cast<std::size_t>(written));
+    }
+    return true;
+}
+
+
+// A gathered write is as atomic as a single one on POSIX. Windows has no gathered write for ordinary handles, so the parts are joined there.
+inline bool emkylog::write_append(const native_handle handle, const std::span<const std::string_view> parts) noexcept {
+    if (parts.size() == 1) {
+        return emkylog::write_append(handle, parts.front());
+    }
+
+#if defined(_WIN32)
+    try {
+        std::string joined;
+        for (const std::string_view part : parts) {
+            joined += part;
+        }
+        return emkylog::write_append(handle, joined);
+    } catch (...) {
+        return false;
+    }
+#else
+    constexpr std::size_t max_parts = 8;
+    ::iovec iov[max_parts];
+    std::size_t count = 0;
+
+    for (const std::string_view part : parts.first(std::min(parts.size(), max_parts))) {
+        iov[count++] = ::iovec{const_cast<char *>(part.data()), part.size()};
+    }
+
+    ::iovec * first = iov;
+    while (count != 0) {
+        ::ssize_t written = ::writev(handle, first, static_cast<int>(count));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        while (count != 0 && static_cast<std::size_t>(written) >= first->iov_len) {
+            written -= static_cast<::ssize_t>(first->iov_len);
+            ++first;
+            --count;
+        }
+        if (count != 0) {
+            first->iov_base = static_cast<char *>(first->iov_base) + written;
+            first->iov_len -= static_cast<std::size_t>(written);
+        }
+    }
+
+    for (const std::string_view part : parts.subspan(std::min(parts.size(), max_parts))) {
+        if (!emkylog::write_append(handle, part)) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+
+inline void emkylog::close_append(native_handle & handle) noexcept {
+    if (handle == emkylog::invalid_handle) {
+        return;
+    }
+#if defined(_WIN32)
+    ::CloseHandle(handle);
+#else
+    ::close(handle);
+#endif
+    handle = emkylog::invalid_handle;
 }
 
 
@@ -724,6 +1388,433 @@ template<typename Tuple, size_t... Is> inline void emkylog::stream_prefix(line &
 }
 
 
+inline bool emkylog::is_unsafe(const unsigned char c, const bool json) noexcept {
+    return c < 0x20 || c == 0x7F || (json && (c == '"' || c == '\\'));
+}
+
+
+// Returns the index of the first byte the sanitizer has to change: a control character, DEL, a JSON special character or the
+// start of malformed UTF-8. Returns the size if there is none. Well-formed UTF-8 is validated in place and is not a change.
+inline std::size_t emkylog::find_unsafe(const std::string_view str, const bool json) noexcept {
+    std::size_t i = 0;
+
+#if defined(EMKYLOG_AVX2) || defined(EMKYLOG_SSE2)
+    const char * const data = str.data();
+    const std::size_t size = str.size();
+#endif
+
+#if defined(EMKYLOG_AVX2)
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i incomplete = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+    __m256i previous = _mm256_setzero_si256();
+    bool pending = false;
+
+    for (; i + 32 <= size; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control), _mm256_cmpeq_epi8(v, del));
+        if (json) {
+            m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)));
+        }
+        if (_mm256_movemask_epi8(_mm256_or_si256(m, v)) == 0) {
+            if (pending) {
+                break;
+            }
+        } else if (!_mm256_testz_si256(m, m)) {
+            break;
+        } else {
+            if (const __m256i errors = emkylog::utf8_errors(v, previous); !_mm256_testz_si256(errors, errors)) {
+                break;
+            }
+            const __m256i tail = _mm256_subs_epu8(v, incomplete);
+            pending = !_mm256_testz_si256(tail, tail);
+        }
+        previous = v;
+    }
+    i = emkylog::utf8_boundary(str, i);
+#elif defined(EMKYLOG_SSSE3)
+    const __m128i control = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i incomplete = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+    __m128i previous = _mm_setzero_si128();
+    bool pending = false;
+
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, control), control), _mm_cmpeq_epi8(v, del));
+        if (json) {
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+        }
+        if (_mm_movemask_epi8(_mm_or_si128(m, v)) == 0) {
+            if (pending) {
+                break;
+            }
+        } else if (_mm_movemask_epi8(m) != 0) {
+            break;
+        } else {
+            if (const __m128i errors = emkylog::utf8_errors(v, previous); _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) != 0xFFFF) {
+                break;
+            }
+            pending = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(v, incomplete), _mm_setzero_si128())) != 0xFFFF;
+        }
+        previous = v;
+    }
+    i = emkylog::utf8_boundary(str, i);
+#elif defined(EMKYLOG_SSE2)
+    const __m128i control = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    while (i + 16 <= size) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, control), control), _mm_cmpeq_epi8(v, del));
+        if (json) {
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+        }
+        if (_mm_movemask_epi8(_mm_or_si128(m, v)) == 0) {
+            i += 16;
+            continue;
+        }
+
+        const auto [next, found] = emkylog::scan_utf8(str, i, i + 16, json);
+        if (found) {
+            return next;
+        }
+        i = next;
+    }
+#endif
+
+    return emkylog::scan_utf8(str, i, str.size(), json).first;
+}
+
+
+// Walks str from a sequence boundary until at least until, validating UTF-8 one sequence at a time.
+// Returns the position of the first change and true, or the boundary it stopped at and false.
+inline std::pair<std::size_t, bool> emkylog::scan_utf8(const std::string_view str, std::size_t i, const std::size_t until, const bool json) noexcept {
+    while (i < until) {
+        if (const auto c = static_cast<unsigned char>(str[i]); c < 0x80) {
+            if (emkylog::is_unsafe(c, json)) {
+                return {i, true};
+            }
+            ++i;
+        } else if (c >= 0xC2 && c <= 0xDF && i + 1 < str.size() && (static_cast<unsigned char>(str[i + 1]) & 0xC0) == 0x80) {
+            i += 2;
+        } else if (const auto [len, valid] = emkylog::utf8_sequence_length(str.substr(i)); valid) {
+            i += len;
+        } else {
+            return {i, true};
+        }
+    }
+    return {std::min(i, str.size()), false};
+}
+
+
+// Backs i up to the start of the sequence it may be in the middle of. Everything before i is known to be well-formed.
+inline std::size_t emkylog::utf8_boundary(const std::string_view str, const std::size_t i) noexcept {
+    for (std::size_t k = 1; k <= 3 && k <= i; ++k) {
+        const auto c = static_cast<unsigned char>(str[i - k]);
+        if (c < 0xC0) {
+            if (c < 0x80) {
+                break;
+            }
+            continue;
+        }
+
+        if (static_cast<std::size_t>(c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2) > k) {
+            return i - k;
+        }
+        break;
+    }
+    return i;
+}
+
+
+#if defined(EMKYLOG_AVX2) || defined(EMKYLOG_SSSE3)
+/* Vectorized UTF-8 validation after Keiser and Lemire, "Validating UTF-8 in less than one instruction per byte" (2021).
+   Three table lookups on the nibbles of each byte and the byte before it classify every two-byte pair, and two saturating
+   subtractions check that 3- and 4-byte sequences have enough continuation bytes. Any non-zero lane is an error. */
+namespace emkylog_utf8 {
+    inline constexpr std::uint8_t too_short = 1<<0;
+    inline constexpr std::uint8_t too_long = 1<<1;
+    inline constexpr std::uint8_t overlong_3 = 1<<2;
+    inline constexpr std::uint8_t too_large = 1<<3;
+    inline constexpr std::uint8_t surrogate = 1<<4;
+    inline constexpr std::uint8_t overlong_2 = 1<<5;
+    inline constexpr std::uint8_t too_large_1000 = 1<<6;
+    inline constexpr std::uint8_t overlong_4 = 1<<6;
+    inline constexpr std::uint8_t two_conts = 1<<7;
+    inline constexpr std::uint8_t carry = too_short | too_long | two_conts;
+
+    alignas(16) inline constexpr std::uint8_t byte_1_high[16] = {
+        too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+        two_conts, two_conts, two_conts, two_conts,
+        too_short | overlong_2,
+        too_short,
+        too_short | overlong_3 | surrogate,
+        too_short | too_large | too_large_1000 | overlong_4
+    };
+
+    alignas(16) inline constexpr std::uint8_t byte_1_low[16] = {
+        carry | overlong_3 | overlong_2 | overlong_4,
+        carry | overlong_2,
+        carry,
+        carry,
+        carry | too_large,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000 | surrogate,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000
+    };
+
+    alignas(16) inline constexpr std::uint8_t byte_2_high[16] = {
+        too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+        too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+        too_long | overlong_2 | two_conts | overlong_3 | too_large,
+        too_long | overlong_2 | two_conts | surrogate | too_large,
+        too_long | overlong_2 | two_conts | surrogate | too_large,
+        too_short, too_short, too_short, too_short
+    };
+}
+#endif
+
+
+#if defined(EMKYLOG_AVX2)
+inline __m256i emkylog::utf8_errors(const __m256i v, const __m256i previous) noexcept {
+    const auto table = [](const std::uint8_t (&t)[16]) {return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(t)));};
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    const __m256i carried = _mm256_permute2x128_si256(previous, v, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(v, carried, 15);
+    const __m256i prev2 = _mm256_alignr_epi8(v, carried, 14);
+    const __m256i prev3 = _mm256_alignr_epi8(v, carried, 13);
+
+    const __m256i special = _mm256_and_si256(_mm256_and_si256(
+        _mm256_shuffle_epi8(table(emkylog_utf8::byte_1_high), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+        _mm256_shuffle_epi8(table(emkylog_utf8::byte_1_low), _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(table(emkylog_utf8::byte_2_high), _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+
+    const __m256i must_be_continuation = _mm256_and_si256(_mm256_or_si256(
+        _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+        _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)))), _mm256_set1_epi8(static_cast<char>(0x80)));
+
+    return _mm256_xor_si256(must_be_continuation, special);
+}
+#elif defined(EMKYLOG_SSSE3)
+inline __m128i emkylog::utf8_errors(const __m128i v, const __m128i previous) noexcept {
+    const auto table = [](const std::uint8_t (&t)[16]) {return _mm_load_si128(reinterpret_cast<const __m128i *>(t));};
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    const __m128i prev1 = _mm_alignr_epi8(v, previous, 15);
+    const __m128i prev2 = _mm_alignr_epi8(v, previous, 14);
+    const __m128i prev3 = _mm_alignr_epi8(v, previous, 13);
+
+    const __m128i special = _mm_and_si128(_mm_and_si128(
+        _mm_shuffle_epi8(table(emkylog_utf8::byte_1_high), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+        _mm_shuffle_epi8(table(emkylog_utf8::byte_1_low), _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(table(emkylog_utf8::byte_2_high), _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+
+    const __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(
+        _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+        _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)))), _mm_set1_epi8(static_cast<char>(0x80)));
+
+    return _mm_xor_si128(must_be_continuation, special);
+}
+#endif
+
+
+// Length of the UTF-8 sequence at the start of str (RFC 3629) and whether it is well-formed.
+// For a malformed one the length is its maximal valid prefix (at least 1 byte), which is replaced by a single U+FFFD.
+inline std::pair<std::size_t, bool> emkylog::utf8_sequence_length(const std::string_view str) noexcept {
+    const auto byte = [&str](const std::size_t i) {return static_cast<unsigned char>(str[i]);};
+    const unsigned char c = byte(0);
+    std::size_t len = 0;
+    unsigned char lo = 0x80, hi = 0xBF;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        return {1, false};
+    }
+
+    if (str.size() < 2 || byte(1) < lo || byte(1) > hi) {
+        return {1, false};
+    }
+
+    for (std::size_t i = 2; i < len; ++i) {
+        if (i >= str.size() || byte(i) < 0x80 || byte(i) > 0xBF) {
+            return {i, false};
+        }
+    }
+    return {len, true};
+}
+
+
+inline void emkylog::escape(const unsigned char c, std::string & out, const bool json) {
+    static constexpr char digits[] = "0123456789abcdef";
+
+    switch (c) {
+        case '\n': out += "\\n"; return;
+        case '\r': out += "\\r"; return;
+        case '\t': out += "\\t"; return;
+        default: break;
+    }
+
+    if (json) {
+        switch (c) {
+            case '"': out += "\\\""; return;
+            case '\\': out += "\\\\"; return;
+            case '\b': out += "\\b"; return;
+            case '\f': out += "\\f"; return;
+            default: break;
+        }
+        out += "\\u00";
+    } else {
+        out += "\\x";
+    }
+    out.push_back(digits[c >> 4]);
+    out.push_back(digits[c & 0xF]);
+}
+
+
+// Appends the escaped form of in to out. Invalid UTF-8 is replaced with U+FFFD unless reject is set, in which case false is returned.
+inline bool emkylog::sanitize(const std::string_view in, std::string & out, const bool json, const bool reject) {
+    std::size_t i = 0;
+
+    while (i < in.size()) {
+        const std::size_t j = i + emkylog::find_unsafe(in.substr(i), json);
+        out.append(in.data() + i, j - i);
+
+        if (j == in.size()) {
+            break;
+        }
+
+        if (const auto c = static_cast<unsigned char>(in[j]); c < 0x80) {
+            emkylog::escape(c, out, json);
+            i = j + 1;
+        } else if (reject) {
+            return false;
+        } else {
+            out += "\xEF\xBF\xBD";
+            i = j + emkylog::utf8_sequence_length(in.substr(j)).first;
+        }
+    }
+    return true;
+}
+
+
+// Points payload at a sanitized copy held in storage if the mode or settings ask for it and the payload is not already clean.
+inline bool emkylog::sanitize_payload(std::string_view & payload, std::string & storage, const std::underlying_type_t<mode> bits, const settings_s & snapshot) {
+    const bool json = (bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::json)) || snapshot.auto_json_escape;
+
+    if (!json && !(bits & static_cast<std::underlying_type_t<emkylog::mode>>(mode::sanitize)) && !snapshot.auto_sanitize) {
+        return true;
+    }
+
+    const std::size_t first = emkylog::find_unsafe(payload, json);
+    if (first == payload.size()) {
+        return true;
+    }
+
+    storage.reserve(payload.size() + (payload.size() - first) / 8 + 8);
+    storage.append(payload.data(), first);
+    if (!emkylog::sanitize(payload.substr(first), storage, json, snapshot.reject_invalid_utf8)) {
+        return false;
+    }
+    payload = storage;
+    return true;
+}
+
+
+template <typename...Args> emkylog::batch & emkylog::batch::add(const level lvl, Args &&... args) {
+    line l(lvl, emkylog::mode::none, false);
+    (l << ... << std::forward<Args>(args));
+    this->body += l.string;
+    this->entries.push_back(entry{.lvl = lvl, .size = l.string.size(), .mode_ = l.mode_});
+    return *this;
+}
+
+
+// Builds every gathered line with the usual prefixes and writes each log file once, all under a single lock of the streams involved.
+// A rejected line (INVALID_UTF8) is dropped and the others are still written; the first error is returned.
+inline emkylog::error_code emkylog::batch::commit() noexcept {
+    if (this->entries.empty()) {
+        return error_code::NO_ERROR;
+    }
+
+    try {
+        if (const emkylog::error_code res = emkylog::ensure_init(); res != error_code::NO_ERROR) {
+            return res;
+        }
+
+        std::string info, error;
+        prefix_cache cache;
+        std::size_t offset = 0;
+        emkylog::error_code rejected = error_code::NO_ERROR;
+
+        for (const entry & e : this->entries) {
+            std::string & record = (e.lvl == level::info) ? info : error;
+            if (const emkylog::error_code res = emkylog::make_record(record, std::string_view(this->body).substr(offset, e.size), e.mode_, cache);
+                res != error_code::NO_ERROR && rejected == error_code::NO_ERROR) {
+                rejected = res;
+            }
+            offset += e.size;
+        }
+
+        this->clear();
+        if (info.empty() && error.empty()) {
+            return rejected;
+        }
+
+        std::unique_lock info_lock (emkylog::log_mtx, std::defer_lock);
+        std::unique_lock error_lock (emkylog::error_log_mtx, std::defer_lock);
+        if (!info.empty() && !error.empty()) {
+            std::lock(info_lock, error_lock);
+        } else if (!info.empty()) {
+            info_lock.lock();
+        } else {
+            error_lock.lock();
+        }
+
+        emkylog::error_code res = rejected;
+        if (!info.empty()) {
+            if (const emkylog::error_code err = emkylog::write_record(level::info, info); res == error_code::NO_ERROR) {
+                res = err;
+            }
+        }
+        if (!error.empty()) {
+            if (const emkylog::error_code err = emkylog::write_record(level::error, error); res == error_code::NO_ERROR) {
+                res = err;
+            }
+        }
+        return res;
+    } catch (...) {
+        return error_code::WRITE_FAILED;
+    }
+}
+
+
 template<typename F> constexpr auto emkylog::observe(const std::string_view name, F && f, std::string_view message) {
     return emkylog::observer<std::decay_t<F>>{name, std::forward<F>(f), message};
 }
@@ -802,5 +1893,191 @@ template<typename F> template<typename Self, typename... Args> decltype(auto) em
 }
 
 
+// Each thread picks one shard for good, so concurrent updates of a metric mostly land on different cache lines.
+inline std::size_t emkylog::metric_shard() noexcept {
+    static std::atomic<std::size_t> next {0};
+    static thread_local const std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % emkylog::metric_shards;
+    return index;
+}
+
+
+// Metrics register at the end of their constructor and unregister first thing in their destructor, so the tick never sees a half-built one.
+template <typename M> void emkylog::register_metric(const M * metric) {
+    std::lock_guard lock (emkylog::metrics_mtx);
+    emkylog::metrics.push_back(metric_entry{metric, [](const void * self, batch & b, const double seconds) {static_cast<const M *>(self)->report(b, seconds);}});
+}
+
+
+inline void emkylog::unregister_metric(const void * metric) noexcept {
+    std::lock_guard lock (emkylog::metrics_mtx);
+    std::erase_if(emkylog::metrics, [metric](const metric_entry & e) {return e.self == metric;});
+}
+
+
+inline emkylog::counter::counter(const std::string_view name) : name_(name) {
+    emkylog::register_metric(this);
+}
+
+
+inline emkylog::counter::~counter() {
+    emkylog::unregister_metric(this);
+}
+
+
+inline void emkylog::counter::report(batch & b, const double seconds) const {
+    std::uint64_t count = 0;
+    for (shard & s : this->shards) {
+        count += s.value.exchange(0, std::memory_order_relaxed);
+    }
+
+    b.log("[Metric] counter ", this->name_, ": count=", count, " rate=", std::format("{:.2f}", seconds > 0 ? static_cast<double>(count) / seconds : 0.0), "/s");
+}
+
+
+inline emkylog::gauge::gauge(const std::string_view name) : name_(name) {
+    emkylog::register_metric(this);
+}
+
+
+inline emkylog::gauge::~gauge() {
+    emkylog::unregister_metric(this);
+}
+
+
+inline void emkylog::gauge::observe(const std::int64_t v) noexcept {
+    shard & s = this->shards[emkylog::metric_shard()];
+
+    std::int64_t current = s.min.load(std::memory_order_relaxed);
+    while (v < current && !s.min.compare_exchange_weak(current, v, std::memory_order_relaxed)) {}
+
+    current = s.max.load(std::memory_order_relaxed);
+    while (v > current && !s.max.compare_exchange_weak(current, v, std::memory_order_relaxed)) {}
+
+    s.samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+inline void emkylog::gauge::report(batch & b, double) const {
+    std::int64_t min = std::numeric_limits<std::int64_t>::max();
+    std::int64_t max = std::numeric_limits<std::int64_t>::min();
+    std::uint64_t samples = 0;
+
+    for (shard & s : this->shards) {
+        min = std::min(min, s.min.exchange(std::numeric_limits<std::int64_t>::max(), std::memory_order_relaxed));
+        max = std::max(max, s.max.exchange(std::numeric_limits<std::int64_t>::min(), std::memory_order_relaxed));
+        samples += s.samples.exchange(0, std::memory_order_relaxed);
+    }
+
+    const std::int64_t value = this->value_.load(std::memory_order_relaxed);
+    if (samples == 0) {
+        b.log("[Metric] gauge ", this->name_, ": value=", value, " samples=0");
+    } else {
+        b.log("[Metric] gauge ", this->name_, ": value=", value, " min=", min, " max=", max, " samples=", samples);
+    }
+}
+
+
+// Bucket i counts the values <= bounds[i] and > bounds[i - 1], the last bucket everything above the largest bound.
+// Every shard owns a row of whole cache lines; the aligned new of bucket_line keeps rows of different shards apart.
+inline emkylog::histogram::histogram(const std::string_view name, const std::initializer_list<double> bounds) : name_(name), bounds(bounds) {
+    std::sort(this->bounds.begin(), this->bounds.end());
+    this->bounds.erase(std::unique(this->bounds.begin(), this->bounds.end()), this->bounds.end());
+
+    this->lines_per_row = (this->bounds.size() + 1 + bucket_line::size - 1) / bucket_line::size;
+    this->lines = std::make_unique<bucket_line[]>(this->lines_per_row * emkylog::metric_shards);
+    emkylog::register_metric(this);
+}
+
+
+inline emkylog::histogram::~histogram() {
+    emkylog::unregister_metric(this);
+}
+
+
+inline void emkylog::histogram::record(const double v) noexcept {
+    const std::size_t shard = emkylog::metric_shard();
+    const std::size_t i = static_cast<std::size_t>(std::lower_bound(this->bounds.begin(), this->bounds.end(), v) - this->bounds.begin());
+    this->bucket(shard, i).fetch_add(1, std::memory_order_relaxed);
+
+    std::atomic<double> & sum = this->sums[shard].sum;
+    double current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + v, std::memory_order_relaxed)) {}
+}
+
+
+inline void emkylog::histogram::report(batch & b, double) const {
+    std::vector<std::uint64_t> counts(this->bounds.size() + 1, 0);
+    std::uint64_t count = 0;
+    double sum = 0;
+
+    for (std::size_t s = 0; s < emkylog::metric_shards; ++s) {
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            const std::uint64_t n = this->bucket(s, i).exchange(0, std::memory_order_relaxed);
+            counts[i] += n;
+            count += n;
+        }
+        sum += this->sums[s].sum.exchange(0, std::memory_order_relaxed);
+    }
+
+    std::string buckets;
+    for (std::size_t i = 0; i < this->bounds.size(); ++i) {
+        buckets += std::format(" <={}:{}", this->bounds[i], counts[i]);
+    }
+    buckets += this->bounds.empty() ? std::format(" all:{}", counts.back()) : std::format(" >{}:{}", this->bounds.back(), counts.back());
+
+    b.log("[Metric] histogram ", this->name_, ": count=", count, " sum=", sum, " mean=", std::format("{:.2f}", count ? sum / static_cast<double>(count) : 0.0), buckets);
+}
+
+
+// Writes one record per registered metric for the interval since the previous flush, all in one batch.
+inline emkylog::error_code emkylog::flush_metrics() {
+    std::lock_guard lock (emkylog::metrics_mtx);
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(now - emkylog::metrics_flushed).count();
+    emkylog::metrics_flushed = now;
+
+    batch b;
+    for (const metric_entry & e : emkylog::metrics) {
+        e.report(e.self, b, seconds);
+    }
+    return b.commit();
+}
+
+
+inline void emkylog::start_metrics(const std::chrono::milliseconds interval) {
+    std::lock_guard lock (emkylog::metrics_thread_mtx);
+    if (emkylog::metrics_thread.joinable()) {
+        emkylog::metrics_thread.request_stop();
+        emkylog::metrics_thread.join();
+    }
+
+    emkylog::metrics_thread = std::jthread([interval](const std::stop_token stop) {
+        std::mutex mtx;
+        std::condition_variable_any cv;
+        std::unique_lock wait_lock (mtx);
+
+        while (!cv.wait_for(wait_lock, stop, interval, [&stop] {return stop.stop_requested();})) {
+            (void)emkylog::flush_metrics();
+        }
+    });
+}
+
+
+// Stops the tick and writes the last, partial interval.
+inline void emkylog::stop_metrics() {
+    std::lock_guard lock (emkylog::metrics_thread_mtx);
+    if (!emkylog::metrics_thread.joinable()) {
+        return;
+    }
+
+    emkylog::metrics_thread.request_stop();
+    emkylog::metrics_thread.join();
+    (void)emkylog::flush_metrics();
+}
+
+
+#pragma pop_macro("max")
+#pragma pop_macro("min")
+#pragma pop_macro("NO_ERROR")
 
-#endif //EMKYLOG_H
\ No newline at end of file
+#endif //EMKYLOG_H
@@ -0,0 +1,108 @@
+/*
+ * EmkyLog
+ * Copyright (c) from 2025 - to 18446744073709551615, author: Natik Agaev
+ * All rights reserved.
+ *
+ * If you find bugs - please, contact IMMEDIATELY!
+ */
+
+/* Lightweight front end of EmkyLog for translation units that only need to log.
+   It pulls in no formatting, chrono, filesystem or stream headers: the arguments are type-erased here and
+   formatted and written by EmkyLog.cpp, which has to be compiled into exactly one target (emkylog_fwd in CMake). */
+
+#ifndef EMKYLOGFWD_H
+#define EMKYLOGFWD_H
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+#include <type_traits>
+
+namespace emkylog_fwd {
+    enum class error_code {
+        NO_ERROR,
+        INIT_FAILED,
+        FILE_CLOSED,
+        FILE_OPENED,
+        CANNOT_OPEN_LOG_FILE,
+        INVALID_FILENAME,
+        FAILED_DIRECTORY_CREATION,
+        CANNOT_OPEN_ERROR_LOG_FILE,
+        FAILED_FILE_CREATION,
+        INVALID_UTF8,
+        WRITE_FAILED
+    };
+
+    enum class mode : std::uint32_t {
+        none,
+        newline = 1<<0,
+        nonewline = 1<<1,
+        threadid = 1<<2,
+        date = 1<<4,
+        time = 1<<5,
+        sanitize = 1<<6,
+        json = 1<<7
+    };
+
+    constexpr mode operator | (const mode m1, const mode m2) noexcept {
+        return static_cast<mode>(static_cast<std::uint32_t>(m1) | static_cast<std::uint32_t>(m2));
+    }
+
+    constexpr mode operator & (const mode m1, const mode m2) noexcept {
+        return static_cast<mode>(static_cast<std::uint32_t>(m1) & static_cast<std::uint32_t>(m2));
+    }
+
+    class arg;
+    error_code log_args(bool, std::initializer_list<arg>);
+
+    class arg {
+        enum class kind : std::uint8_t {text, character, boolean, signed_integer, unsigned_integer, float_, double_, long_double, control};
+
+        kind kind_;
+        union {
+            struct {const char * data; std::size_t size;} text;
+            char character;
+            bool boolean;
+            long long signed_integer;
+            unsigned long long unsigned_integer;
+            float float_;
+            double double_;
+            long double long_double;
+            mode control;
+        };
+
+        friend error_code log_args(bool, std::initializer_list<arg>);
+
+    public:
+        constexpr arg(const std::string_view s) noexcept : kind_(kind::text), text{s.data(), s.size()} {}
+        constexpr arg(const char * s) noexcept : arg(std::string_view(s)) {}
+        constexpr arg(const char ch) noexcept : kind_(kind::character), character(ch) {}
+        constexpr arg(const bool b) noexcept : kind_(kind::boolean), boolean(b) {}
+        constexpr arg(const mode m) noexcept : kind_(kind::control), control(m) {}
+
+        template <typename T> requires (std::is_integral_v<T> && std::is_signed_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>)
+        constexpr arg(const T v) noexcept : kind_(kind::signed_integer), signed_integer(v) {}
+
+        template <typename T> requires (std::is_integral_v<T> && std::is_unsigned_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>)
+        constexpr arg(const T v) noexcept : kind_(kind::unsigned_integer), unsigned_integer(v) {}
+
+        constexpr arg(const float v) noexcept : kind_(kind::float_), float_(v) {}
+        constexpr arg(const double v) noexcept : kind_(kind::double_), double_(v) {}
+        constexpr arg(const long double v) noexcept : kind_(kind::long_double), long_double(v) {}
+
+        template <typename T> requires std::is_convertible_v<const T &, std::string_view>
+        constexpr arg(const T & s) noexcept : arg(static_cast<std::string_view>(s)) {}
+    };
+
+    error_code init();
+    error_code Init();
+    error_code close();
+    error_code Close();
+
+    template <typename...Args> error_code log(const Args &...args) {return emkylog_fwd::log_args(false, {arg(args)...});}
+    template <typename...Args> error_code Log(const Args &...args) {return emkylog_fwd::log_args(false, {arg(args)...});}
+    template <typename...Args> error_code log_error(const Args &...args) {return emkylog_fwd::log_args(true, {arg(args)...});}
+    template <typename...Args> error_code LogError(const Args &...args) {return emkylog_fwd::log_args(true, {arg(args)...});}
+}
+
+#endif //EMKYLOGFWD_H
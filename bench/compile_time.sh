@@ -0,0 +1,86 @@
+#!/usr/bin/env sh
+# Compile-time benchmark: compiles N translation units that log a few lines, once including EmkyLog.h, once including
+# EmkyLogFwd.h and once with `import emkylog;` (EmkyLog.cppm is built once first), and prints the wall-clock time of each run.
+# Usage: bench/compile_time.sh [N] (the compiler is taken from $CXX, default c++; extra flags from $CXXFLAGS)
+# Modules are built with -fmodules-ts for GCC and --precompile for Clang; the module run is skipped if this compiler cannot import it.
+
+set -e
+
+N=${1:-50}
+CXX=${CXX:-c++}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+
+# date +%N is a GNU extension (BSD and macOS date print a literal N), so fall back to perl there.
+now() {
+    t=$(date +%s.%N 2>/dev/null || true)
+    case "$t" in
+        *N*|'') perl -MTime::HiRes=time -e 'printf "%.3f\n", time' ;;
+        *) echo "$t" ;;
+    esac
+}
+
+elapsed() {
+    awk "BEGIN {printf \"%.2f\", $2 - $1}"
+}
+
+generate() {
+    i=0
+    while [ "$i" -lt "$N" ]; do
+        cat > "$1_$i.cpp" <<SRC
+$2
+int tu_$i(int depth) {
+    $3::log("depth=", depth, " tu=", $i);
+    $3::log_error("failed at ", 2.5, ' ', true);
+    return depth;
+}
+SRC
+        i=$((i + 1))
+    done
+}
+
+run() {
+    name=$1
+    shift
+    start=$(now)
+    for f in "$name"_*.cpp; do
+        $CXX -std=c++20 $CXXFLAGS "$@" -I"$ROOT" -c "$f" -o "$f.o"
+    done
+    echo "$name: $(elapsed "$start" "$(now)") s for $N translation units"
+}
+
+case "$($CXX --version 2>/dev/null)" in
+    *clang*)
+        build_module() { $CXX -std=c++20 $CXXFLAGS -I"$ROOT" -x c++-module --precompile "$ROOT/EmkyLog.cppm" -o emkylog.pcm; }
+        module_flags="-fmodule-file=emkylog=$WORK/emkylog.pcm"
+        ;;
+    *)
+        build_module() { $CXX -std=c++20 -fmodules-ts $CXXFLAGS -I"$ROOT" -x c++ -c "$ROOT/EmkyLog.cppm" -o emkylog.o; }
+        module_flags="-fmodules-ts"
+        ;;
+esac
+
+echo "$($CXX --version 2>/dev/null | head -n 1), CXXFLAGS=$CXXFLAGS"
+
+generate full '#include "EmkyLog.h"' emkylog
+generate fwd '#include "EmkyLogFwd.h"' emkylog_fwd
+generate module 'import emkylog;' emkylog
+
+run full
+run fwd
+
+start=$(now)
+if ! build_module 2>/dev/null; then
+    echo "module: skipped, EmkyLog.cppm does not build with this compiler"
+    exit 0
+fi
+echo "module interface: $(elapsed "$start" "$(now)") s, built once"
+
+# GCC 12 builds the interface but does not export the using-declaration of the class from the global module fragment.
+if ! $CXX -std=c++20 $CXXFLAGS $module_flags -I"$ROOT" -c module_0.cpp -o module_0.cpp.o 2>/dev/null; then
+    echo "module: skipped, this compiler does not see the emkylog class exported by EmkyLog.cppm"
+    exit 0
+fi
+run module $module_flags